@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+#
+# mock Pi-hole for the gkrellm-pihole soak test
+# answers /admin/api.php like a Pi-hole v5 would, with scriptable faults:
+# latency, HTTP errors, truncated JSON, "[]" for a bad key, dropped and hung
+# connections, oversized bodies, and an online/offline flapping cycle
+#
+# every knob can be changed while running:
+#   curl 'http://127.0.0.1:8080/mock/set?latency_ms=500&error_rate=0.1'
+#   curl 'http://127.0.0.1:8080/mock/stats'
+#
+
+import argparse
+import json
+import random
+import socket
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlparse, parse_qs
+
+# knob types, raising ValueError on out of range values like int() does
+def amount(text):
+    value = int(text)
+    if value < 0:
+        raise ValueError("negative")
+    return value
+
+
+def rate(text):
+    value = float(text)
+    if not 0.0 <= value <= 1.0:  # also false for nan
+        raise ValueError("not a probability")
+    return value
+
+
+# knob name -> (type, default, help)
+KNOBS = {
+    "latency_ms":    (amount, 0,    "fixed delay before answering"),
+    "jitter_ms":     (amount, 0,    "random extra delay, 0..jitter_ms"),
+    "error_rate":    (rate,   0.0,  "probability of an HTTP 500"),
+    "truncate_rate": (rate,   0.0,  "probability of cutting the JSON in half"),
+    "badkey_rate":   (rate,   0.0,  "probability of answering [] (bad API key)"),
+    "drop_rate":     (rate,   0.0,  "probability of closing without answering"),
+    "hang_rate":     (rate,   0.0,  "probability of hanging for hang_ms"),
+    "hang_ms":       (amount, 5000, "how long a hung request stalls"),
+    "disabled_rate": (rate,   0.0,  "probability of reporting status disabled"),
+    "payload_bytes": (amount, 0,    "pad the summary up to this many bytes"),
+    "flap_period":   (amount, 0,    "seconds online then offline, 0 = never"),
+    "api_key":       (str,    "",   "expected auth=, empty accepts anything"),
+}
+
+config = {name: spec[1] for name, spec in KNOBS.items()}
+stats = {"requests": 0, "ok": 0, "error": 0, "truncated": 0, "badkey": 0,
+         "dropped": 0, "hung": 0, "offline": 0, "client_gone": 0}
+lock = threading.Lock()
+started = time.monotonic()
+blocking_until = 0.0  # 0 = enabled, -1 = disabled indefinitely
+
+
+def roll(name):
+    return random.random() < config[name]
+
+
+def count(name):
+    with lock:
+        stats[name] += 1
+
+
+def summary():
+    disabled = blocking_until < 0 or blocking_until > time.monotonic() \
+        or roll("disabled_rate")
+    queries = 20000 + int(time.monotonic() - started) * 3
+    body = {
+        "domains_being_blocked": 123456,
+        "dns_queries_today": queries,
+        "ads_blocked_today": queries // 7,
+        "ads_percentage_today": 14.285714,
+        "unique_domains": 4242,
+        "queries_forwarded": queries // 2,
+        "queries_cached": queries // 3,
+        "clients_ever_seen": 12,
+        "unique_clients": 10,
+        "status": "disabled" if disabled else "enabled",
+        # as on a real v5, status is followed by a comma, the plugin relies on it
+        "gravity_last_updated": {
+            "file_exists": True,
+            "absolute": int(time.time()) - 3600,
+            "relative": {"days": 0, "hours": 1, "minutes": 0},
+        },
+    }
+    text = json.dumps(body, separators=(",", ":"))
+    pad = config["payload_bytes"] - len(text) - len(',"padding":""')
+    if pad > 0:
+        # the plugin scans the raw body, so keep the real fields up front
+        text = text[:-1] + ',"padding":"' + "x" * pad + '"}'
+    return text
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def answer(self, code, body, ctype="application/json"):
+        data = body.encode()
+        try:
+            self.send_response(code)
+            self.send_header("Content-Type", ctype)
+            self.send_header("Content-Length", str(len(data)))
+            self.end_headers()
+            self.wfile.write(data)
+        except (BrokenPipeError, ConnectionResetError):
+            # the plugin gave up first (curl timeout), nothing to answer to
+            count("client_gone")
+            self.close_connection = True
+            return False
+        return True
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        query = parse_qs(url.query, keep_blank_values=True)
+
+        if url.path == "/mock/set":
+            return self.set_knobs(query)
+        if url.path == "/mock/stats":
+            with lock:
+                return self.answer(200, json.dumps({"config": config,
+                                                    "stats": stats}))
+        if url.path != "/admin/api.php":
+            return self.answer(404, "not found\n", "text/plain")
+
+        count("requests")
+
+        if config["flap_period"] > 0:
+            phase = int(time.monotonic() - started) // config["flap_period"]
+            if phase % 2:
+                count("offline")
+                return self.drop()
+
+        delay = config["latency_ms"]
+        if config["jitter_ms"] > 0:
+            delay += random.randint(0, config["jitter_ms"])
+        if roll("hang_rate"):
+            count("hung")
+            delay += config["hang_ms"]
+        if delay:
+            time.sleep(delay / 1000.0)
+
+        if roll("drop_rate"):
+            count("dropped")
+            return self.drop()
+        if roll("error_rate"):
+            count("error")
+            return self.answer(500, "<html>Internal Server Error</html>",
+                               "text/html")
+        key = query.get("auth", [""])[0]
+        if roll("badkey_rate") or (config["api_key"] and
+                                   key != config["api_key"]):
+            count("badkey")
+            return self.answer(200, "[]")
+
+        if "disable" in query:
+            seconds = query["disable"][0]
+            if seconds and not seconds.isdigit():
+                return self.answer(400, "bad value for disable\n",
+                                   "text/plain")
+            self.set_blocking(seconds)
+            return self.answer(200, '{"status":"disabled"}')
+        if "enable" in query:
+            self.set_blocking(None)
+            return self.answer(200, '{"status":"enabled"}')
+
+        body = summary()
+        if roll("truncate_rate"):
+            count("truncated")
+            return self.answer(200, body[:random.randint(1, len(body) - 1)])
+        if self.answer(200, body):
+            count("ok")
+
+    def drop(self):
+        self.close_connection = True
+        try:
+            self.connection.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+
+    def set_blocking(self, seconds):
+        global blocking_until
+        if seconds is None:
+            blocking_until = 0.0
+        elif seconds == "":
+            blocking_until = -1
+        else:
+            blocking_until = time.monotonic() + int(seconds)
+
+    def set_knobs(self, query):
+        # validate the whole query first, a 400 must leave the config alone
+        changes = {}
+        for name, values in query.items():
+            if name not in KNOBS:
+                return self.answer(400, "unknown knob %s\n" % name,
+                                   "text/plain")
+            try:
+                changes[name] = KNOBS[name][0](values[0])
+            except ValueError:
+                return self.answer(400, "bad value for %s\n" % name,
+                                   "text/plain")
+        with lock:
+            config.update(changes)
+            current = json.dumps(config)
+        return self.answer(200, current)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="fault-injecting mock Pi-hole")
+    parser.add_argument("--listen", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--seed", type=int, help="seed the fault dice")
+    for name, (kind, default, text) in KNOBS.items():
+        parser.add_argument("--" + name.replace("_", "-"), dest=name,
+                            type=kind, default=default,
+                            help="%s (default %s)" % (text, default))
+    args = parser.parse_args()
+
+    for name in KNOBS:
+        config[name] = getattr(args, name)
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    try:
+        server = ThreadingHTTPServer((args.listen, args.port), Handler)
+    except OSError as e:
+        parser.error("cannot listen on %s:%d: %s" % (args.listen, args.port,
+                                                     e.strerror))
+    server.daemon_threads = True
+    print("mock pihole listening on %s:%d" % (args.listen, args.port),
+          flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,350 @@
+/*
+ * headless soak driver for the gkrellm-pihole plugin
+ * builds the plugin source in, stubs out the gkrellm drawing calls,
+ * and runs update_plugin() ticks against a (mock) pihole for hours,
+ * reporting main-loop stall time, RSS, open fds and poll success rate
+ * (c) 2023 JCC gkrellm@cardot.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "../gkrellm-pihole.c"
+
+#define SOAK_DEFAULT_HOST        "127.0.0.1:8080"
+#define SOAK_DEFAULT_DURATION    3600
+#define SOAK_DEFAULT_TICK_MS     100  /* gkrellm default update rate is 10 ticks/s */
+#define SOAK_DEFAULT_REPORT      60
+#define SOAK_DEFAULT_WARMUP      10   /* polls before taking the RSS/fd baseline */
+#define SOAK_DEFAULT_MAX_STALL   250  /* ms the gkrellm display may freeze */
+#define SOAK_DEFAULT_MAX_RSS     1024 /* kB of growth after warmup */
+#define SOAK_DEFAULT_MAX_FDS     4    /* fds opened after warmup */
+
+static GkrellmTicks soak_ticks;
+static GkrellmTextstyle soak_textstyle;
+static GkrellmPanel soak_panel;
+static GkrellmDecal soak_decals[5];
+static gint soak_polls_ok;
+
+/***********************************************************/
+/* gkrellm stubs: just enough for update_plugin() to run    */
+
+GkrellmTicks *gkrellm_ticks(void) { return &soak_ticks; }
+gint gkrellm_add_meter_style(GkrellmMonitor *mon, gchar *name) { return 0; }
+GkrellmStyle *gkrellm_meter_style(gint style_id) { return NULL; }
+GkrellmTextstyle *gkrellm_meter_textstyle(gint style_id) { return &soak_textstyle; }
+GkrellmTextstyle *gkrellm_meter_alt_textstyle(gint style_id) { return &soak_textstyle; }
+gint gkrellm_chart_width(void) { return 100; }
+void gkrellm_draw_decal_pixmap(GkrellmPanel *p, GkrellmDecal *d, gint index) { }
+void gkrellm_draw_panel_layers(GkrellmPanel *p) { }
+void gkrellm_open_config_window(GkrellmMonitor *mon) { }
+void gkrellm_disable_plugin_connect(GkrellmMonitor *mon, void (*cb_func)()) { }
+GkrellmPanel *gkrellm_panel_new0(void) { return &soak_panel; }
+void gkrellm_panel_configure(GkrellmPanel *p, gchar *string, GkrellmStyle *style) { }
+void gkrellm_panel_create(GtkWidget *box, GkrellmMonitor *mon, GkrellmPanel *p) { }
+GtkWidget *gkrellm_gtk_framed_notebook_page(GtkWidget *tabs, char *name) { return NULL; }
+GtkWidget *gkrellm_gtk_scrolled_text_view(GtkWidget *box, GtkWidget **scr,
+    GtkPolicyType h_policy, GtkPolicyType v_policy) { return NULL; }
+void gkrellm_gtk_text_view_append(GtkWidget *view, gchar *s) { }
+
+GkrellmDecal
+*gkrellm_create_decal_pixmap(GkrellmPanel *p, GdkPixmap *pixmap, GdkBitmap *mask,
+    gint depth, GkrellmStyle *style, gint x, gint y) {
+  return &soak_decals[0];
+}
+
+GkrellmDecal
+*gkrellm_create_decal_text(GkrellmPanel *p, gchar *string, GkrellmTextstyle *ts,
+    GkrellmStyle *style, gint x, gint y, gint w) {
+  return &soak_decals[1];
+}
+
+void
+gkrellm_draw_decal_text(GkrellmPanel *p, GkrellmDecal *d, gchar *s, gint value) {
+  // update_thread() only draws the values once pihole() succeeded
+  if (d == decal_text1)
+    soak_polls_ok++;
+}
+
+/* no X display here: override the gdk font calls used to right align values */
+GdkFont *gdk_font_from_description(PangoFontDescription *font_desc) { return NULL; }
+gint gdk_string_width(GdkFont *font, const gchar *string) { return 6 * strlen(string); }
+
+/***********************************************************/
+
+static gdouble
+now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static glong
+rss_kb(void) {
+  FILE *f;
+  glong pages = 0, resident = 0;
+
+  f = fopen("/proc/self/statm", "r");
+  if (f == NULL)
+    return -1;
+  if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+    resident = -1;
+  fclose(f);
+  return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* peak RSS since the last reset_rss_peak(), catches bodies already freed */
+static glong
+rss_peak_kb(void) {
+  FILE *f;
+  gchar line[256];
+  glong kb = -1;
+
+  f = fopen("/proc/self/status", "r");
+  if (f == NULL)
+    return -1;
+  while (fgets(line, sizeof(line), f) != NULL)
+    if (sscanf(line, "VmHWM: %ld", &kb) == 1)
+      break;
+  fclose(f);
+  return kb;
+}
+
+static void
+reset_rss_peak(void) {
+  FILE *f;
+
+  f = fopen("/proc/self/clear_refs", "w");
+  if (f == NULL)
+    return;
+  fputs("5", f);
+  fclose(f);
+}
+
+static gint
+open_fds(void) {
+  DIR *dir;
+  struct dirent *entry;
+  gint n = 0;
+
+  dir = opendir("/proc/self/fd");
+  if (dir == NULL)
+    return -1;
+  while ((entry = readdir(dir)) != NULL)
+    if (entry->d_name[0] != '.')
+      n++;
+  closedir(dir);
+  return n - 1; // the fd opendir() itself holds
+}
+
+static void
+usage(gchar *name) {
+  fprintf(stderr,
+    "usage: %s [options]\n"
+    "  -H host[:port]  pihole to poll (default " SOAK_DEFAULT_HOST ")\n"
+    "  -k key          API key (default \"soak\")\n"
+    "  -d seconds      soak duration (default %d)\n"
+    "  -f seconds      plugin refresh frequency (default %d)\n"
+    "  -t ms           gkrellm tick interval, dividing 1000 (default %d)\n"
+    "  -F              fast mode: do not sleep between ticks, the driver's time is\n"
+    "                  simulated but the mock's flap, disable=N and counters are not\n"
+    "  -r seconds      report interval (default %d)\n"
+    "  -w polls        warmup polls before the RSS/fd baseline (default %d)\n"
+    "  -s ms           fail if a tick stalls the main loop longer (default %d)\n"
+    "  -m kB           fail if RSS grows more after warmup (default %d)\n"
+    "  -n fds          fail if more fds are open after warmup (default %d)\n",
+    name, SOAK_DEFAULT_DURATION, PIHOLE_DEFAULT_FREQ, SOAK_DEFAULT_TICK_MS,
+    SOAK_DEFAULT_REPORT, SOAK_DEFAULT_WARMUP, SOAK_DEFAULT_MAX_STALL,
+    SOAK_DEFAULT_MAX_RSS, SOAK_DEFAULT_MAX_FDS);
+}
+
+int
+main(int argc, char **argv) {
+  gchar *host = SOAK_DEFAULT_HOST, *key = "soak", *line;
+  gint duration = SOAK_DEFAULT_DURATION, freq = PIHOLE_DEFAULT_FREQ;
+  gint tick_ms = SOAK_DEFAULT_TICK_MS, report = SOAK_DEFAULT_REPORT;
+  gint warmup = SOAK_DEFAULT_WARMUP, max_stall = SOAK_DEFAULT_MAX_STALL;
+  gint max_rss = SOAK_DEFAULT_MAX_RSS, max_fds = SOAK_DEFAULT_MAX_FDS;
+  gboolean fast = FALSE;
+  GkrellmMonitor *mon;
+  gint opt, ticks_per_second, second, last_second = -1, next_report;
+  gint lost = 0, lost_total = 0;
+  glong n;
+  gint ticks = 0, polls = 0, polls_ok = 0, polls_total = 0, polls_ok_total = 0, stalled_ticks = 0;
+  glong rss, rss_base = -1, rss_peak = 0;
+  gint fds, fds_base = -1, fds_peak = 0;
+  gdouble start, elapsed, t0, stall, stall_max = 0, stall_sum = 0, poll_sum = 0;
+  gdouble stall_max_total = 0;
+  gboolean failed = FALSE;
+  FILE *out;
+
+  while ((opt = getopt(argc, argv, "H:k:d:f:t:Fr:w:s:m:n:h")) != -1) {
+    switch (opt) {
+      case 'H': host = optarg; break;
+      case 'k': key = optarg; break;
+      case 'd': duration = atoi(optarg); break;
+      case 'f': freq = atoi(optarg); break;
+      case 't': tick_ms = atoi(optarg); break;
+      case 'F': fast = TRUE; break;
+      case 'r': report = atoi(optarg); break;
+      case 'w': warmup = atoi(optarg); break;
+      case 's': max_stall = atoi(optarg); break;
+      case 'm': max_rss = atoi(optarg); break;
+      case 'n': max_fds = atoi(optarg); break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if (tick_ms <= 0 || tick_ms > 1000 || 1000 % tick_ms || freq <= 0 || report <= 0 ||
+      warmup < 1 || duration <= 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  /* the plugin puts() its errors on stdout: keep the report on the real
+   * stdout and send whatever the plugin prints to stderr */
+  out = fdopen(dup(STDOUT_FILENO), "w");
+  if (out == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+    perror("cannot split the report from the plugin output");
+    return 2;
+  }
+  ticks_per_second = 1000 / tick_ms;
+
+  /* same sequence as gkrellm: init, load the config, create the panel */
+  mon = gkrellm_init_plugin();
+  line = g_strdup_printf("pihole_hostname %s", host);
+  mon->load_user_config(line);
+  g_free(line);
+  line = g_strdup_printf("pihole_api_key %s", key);
+  mon->load_user_config(line);
+  g_free(line);
+  line = g_strdup_printf("pihole_freq %d", freq);
+  mon->load_user_config(line);
+  g_free(line);
+
+  enable_plugin();
+  panel = gkrellm_panel_new0();
+  decal_pihole_icon = &soak_decals[0];
+  decal_label1 = &soak_decals[1];
+  decal_text1 = &soak_decals[2];
+  decal_label2 = &soak_decals[3];
+  decal_text2 = &soak_decals[4];
+
+  fprintf(out, "soaking %s for %ds, refresh %ds, tick %dms%s\n",
+          pihole_URL, duration, freq, tick_ms, fast ? " (fast)" : "");
+  fprintf(out, "%8s %6s %6s %10s %10s %10s %5s %8s %5s\n",
+          "time", "polls", "ok%", "stall_max", "stall_avg", "poll_avg", "lost", "rss_kB", "fds");
+  fflush(out);
+
+  start = now_ms();
+  next_report = report;
+  for (n = 0; ; n++) {
+    /* like gkrellm, second_tick follows the clock: the seconds a stalled
+     * tick swallowed are lost, not replayed, so update counts fewer seconds */
+    second = fast ? n / ticks_per_second : (now_ms() - start) / 1000;
+
+    if (second >= next_report || second >= duration) {
+      rss = rss_kb();
+      fds = open_fds();
+      if (rss_base >= 0) {
+        if (rss > rss_peak) rss_peak = rss;
+        if (fds > fds_peak) fds_peak = fds;
+      }
+      if (stall_max > stall_max_total) stall_max_total = stall_max;
+      fprintf(out, "%8d %6d %5.1f%% %8.1fms %8.3fms %8.1fms %5d %8ld %5d\n",
+              second, polls,
+              polls ? 100.0 * polls_ok / polls : 0.0,
+              stall_max, ticks ? stall_sum / ticks : 0.0,
+              polls ? poll_sum / polls : 0.0, lost, rss, fds);
+      fflush(out);
+      ticks = polls = polls_ok = lost = 0;
+      stall_max = stall_sum = poll_sum = 0;
+      while (next_report <= second)
+        next_report += report;
+    }
+    if (second >= duration)
+      break;
+
+    soak_ticks.second_tick = (second != last_second);
+    soak_ticks.minute_tick = soak_ticks.second_tick &&
+                             (last_second < 0 || second / 60 != last_second / 60);
+    if (soak_ticks.second_tick && last_second >= 0) {
+      lost += second - last_second - 1;
+      lost_total += second - last_second - 1;
+    }
+    last_second = second;
+
+    gint update_before = update, ok_before = soak_polls_ok;
+    t0 = now_ms();
+    mon->update_monitor();
+    stall = now_ms() - t0;
+
+    ticks++;
+    stall_sum += stall;
+    if (stall > stall_max)
+      stall_max = stall;
+    if (stall > max_stall)
+      stalled_ticks++;
+    /* update only moves on second ticks, and drops back to 0 when it polls */
+    if (update == 0 && (soak_ticks.second_tick || update_before < 0)) {
+      polls++;
+      poll_sum += stall;
+      polls_total++;
+      polls_ok += soak_polls_ok - ok_before;
+      polls_ok_total += soak_polls_ok - ok_before;
+      /* sample after each poll; a multi-MB body is already freed, hence VmHWM */
+      if (polls_total == warmup) {
+        rss_base = rss_peak = rss_kb();
+        fds_base = fds_peak = open_fds();
+        reset_rss_peak();
+      }
+      else if (rss_base >= 0) {
+        rss = rss_peak_kb();
+        fds = open_fds();
+        if (rss > rss_peak) rss_peak = rss;
+        if (fds > fds_peak) fds_peak = fds;
+      }
+    }
+
+    if (!fast) {
+      /* sleep to the next tick boundary, skipping the ones already missed */
+      elapsed = now_ms() - start;
+      usleep(((glong)(elapsed / tick_ms) + 1) * tick_ms * 1000.0 - elapsed * 1000.0);
+    }
+  }
+
+  disable_plugin();
+
+  fprintf(out, "\n%d polls, %d ok (%.1f%%), worst stall %.1fms, %d ticks over %dms\n",
+          polls_total, polls_ok_total,
+          polls_total ? 100.0 * polls_ok_total / polls_total : 0.0,
+          stall_max_total, stalled_ticks, max_stall);
+  if (lost_total > 0)
+    fprintf(out, "%d second ticks lost to stalled ticks, the plugin saw %d seconds out of %d\n",
+            lost_total, duration - lost_total, duration);
+  if (rss_base < 0) {
+    fprintf(out, "FAIL: fewer than %d polls, no RSS/fd baseline\n", warmup);
+    return 1;
+  }
+  fprintf(out, "RSS %ld kB after warmup, peak %ld kB (+%ld kB); fds %d after warmup, peak %d\n",
+          rss_base, rss_peak, rss_peak - rss_base, fds_base, fds_peak);
+
+  if (stalled_ticks > 0) {
+    fprintf(out, "FAIL: %d ticks stalled the main loop over %dms\n", stalled_ticks, max_stall);
+    failed = TRUE;
+  }
+  if (rss_peak - rss_base > max_rss) {
+    fprintf(out, "FAIL: RSS grew by %ld kB (limit %d kB)\n", rss_peak - rss_base, max_rss);
+    failed = TRUE;
+  }
+  if (fds_peak - fds_base > max_fds) {
+    fprintf(out, "FAIL: %d fds opened (limit %d)\n", fds_peak - fds_base, max_fds);
+    failed = TRUE;
+  }
+  if (!failed)
+    fputs("PASS\n", out);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+#!/bin/sh
+# start the mock pihole, soak the plugin against it, stop the mock
+# mock options go before "--", soak driver options after, e.g.
+#   ./soak.sh --latency-ms 300 --truncate-rate 0.05 -- -d 7200 -m 512 -s 2500
+cd `dirname $0`
+PORT=${PORT:-8080}
+MOCK_ARGS=""
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+  MOCK_ARGS="$MOCK_ARGS $1"
+  shift
+done
+[ "$1" = "--" ] && shift
+
+./build || exit 2 # always, so the soak never runs a stale plugin
+./mock-pihole.py --port $PORT $MOCK_ARGS &
+MOCK=$!
+trap 'kill $MOCK 2>/dev/null' EXIT INT TERM
+sleep 1
+kill -0 $MOCK 2>/dev/null || { echo "mock pihole did not start (port $PORT in use?)" >&2; exit 2; }
+./pihole-soak -H 127.0.0.1:$PORT "$@"